@@ -0,0 +1,360 @@
+# Generates tables.h: every precomputed table the engine needs, as const data, so startup does no work.
+# Usage: python3 generate_tables.py [output path, default tables.h]
+#        python3 generate_tables.py --find-magics   (prints new fancy magic multipliers)
+#
+# Squares are numbered a8 = 0 ... h1 = 63, as in game_pext.c, so "up" (towards rank 8) is a right shift.
+
+import random
+import sys
+
+MASK64 = 0xffffffffffffffff
+
+# Constants for file masks (same as the C ULL constants)
+NOT_A_FILE = 0xfefefefefefefefe  # All bits set except A-file
+NOT_H_FILE = 0x7f7f7f7f7f7f7f7f  # All bits set except H-file
+NOT_AB_FILE = 0xfcfcfcfcfcfcfcfc # All bits set except A and B files
+NOT_HG_FILE = 0x3f3f3f3f3f3f3f3f # All bits set except H and G files
+
+WHITE, BLACK = 0, 1
+
+# ------------------------------------------------------------------------------------------------
+# Zobrist keys
+
+def zobrist_keys():
+    """Draws the keys from the same xorshift stream, in the same order, that init_zobrist_keys used,
+    so hash keys (and anything keyed on them) are unchanged."""
+    state = 1804289383
+
+    def next_random():
+        nonlocal state
+        number = state
+        number ^= (number << 13) & MASK64
+        number ^= number >> 7
+        number ^= (number << 17) & MASK64
+        state = number
+        return number
+
+    piece_keys = [[next_random() for _ in range(64)] for _ in range(12)]
+    side_key = next_random()
+    castle_keys = [next_random() for _ in range(16)]
+    enpassant_keys = [next_random() for _ in range(9)]
+    material_weights = [next_random() for _ in range(12)]
+    return piece_keys, side_key, castle_keys, enpassant_keys, material_weights
+
+# ------------------------------------------------------------------------------------------------
+# Leaper attacks
+
+def pawn_attacks(color):
+    """White pawns attack towards rank 8 (smaller indices), black pawns towards rank 1."""
+    table = []
+    for sq in range(64):
+        b = 1 << sq
+        if color == WHITE:
+            table.append(((b >> 9) & NOT_H_FILE) | ((b >> 7) & NOT_A_FILE))
+        else:
+            table.append((((b << 7) & NOT_H_FILE) | ((b << 9) & NOT_A_FILE)) & MASK64)
+    return table
+
+def knight_attacks():
+    """The masks clear targets that wrapped around to the other side of the board."""
+    table = []
+    for sq in range(64):
+        b = 1 << sq
+        attacks = 0
+        attacks |= ((b >> 17) & NOT_H_FILE)  # Up 2, Left 1
+        attacks |= ((b >> 15) & NOT_A_FILE)  # Up 2, Right 1
+        attacks |= ((b >> 10) & NOT_HG_FILE) # Up 1, Left 2
+        attacks |= ((b >>  6) & NOT_AB_FILE) # Up 1, Right 2
+        attacks |= ((b << 17) & NOT_A_FILE)  # Down 2, Right 1
+        attacks |= ((b << 15) & NOT_H_FILE)  # Down 2, Left 1
+        attacks |= ((b << 10) & NOT_AB_FILE) # Down 1, Right 2
+        attacks |= ((b <<  6) & NOT_HG_FILE) # Down 1, Left 2
+        table.append(attacks & MASK64)
+    return table
+
+def king_attacks():
+    table = []
+    for sq in range(64):
+        b = 1 << sq
+        attacks = 0
+        attacks |= (b >> 8)                  # North
+        attacks |= ((b >> 9) & NOT_H_FILE)   # North-West
+        attacks |= ((b >> 7) & NOT_A_FILE)   # North-East
+        attacks |= ((b >> 1) & NOT_H_FILE)   # West
+        attacks |= (b << 8)                  # South
+        attacks |= ((b << 9) & NOT_A_FILE)   # South-East
+        attacks |= ((b << 7) & NOT_H_FILE)   # South-West
+        attacks |= ((b << 1) & NOT_A_FILE)   # East
+        table.append(attacks & MASK64)
+    return table
+
+# ------------------------------------------------------------------------------------------------
+# Sliders
+
+BISHOP_DIRECTIONS = [(1, 1), (-1, 1), (1, -1), (-1, -1)]
+ROOK_DIRECTIONS = [(1, 0), (-1, 0), (0, 1), (0, -1)]
+
+def slider_attacks(sq, blockers, directions):
+    """Rays from sq, each stopping on (and including) the first blocker."""
+    attacks = 0
+    for dr, df in directions:
+        r, f = sq // 8 + dr, sq % 8 + df
+        while 0 <= r <= 7 and 0 <= f <= 7:
+            bit = 1 << (r * 8 + f)
+            attacks |= bit
+            if bit & blockers:
+                break
+            r, f = r + dr, f + df
+    return attacks
+
+def slider_mask(sq, directions):
+    """Relevant occupancy: the rays without the edge square at their end, which never changes the attacks."""
+    mask = 0
+    for dr, df in directions:
+        r, f = sq // 8 + dr, sq % 8 + df
+        while 0 <= r + dr <= 7 and 0 <= f + df <= 7:
+            mask |= 1 << (r * 8 + f)
+            r, f = r + dr, f + df
+    return mask
+
+def slider_table(directions):
+    """Per-square masks and one attack array for all squares, with each square's start offset.
+    Subsets are enumerated with the carry-rippler trick, which visits them in increasing _pext_u64 order,
+    so the attacks for occupancy o sit at offset + _pext_u64(o, mask)."""
+    masks, offsets, attacks = [], [], []
+    for sq in range(64):
+        mask = slider_mask(sq, directions)
+        masks.append(mask)
+        offsets.append(len(attacks))
+        subset = 0
+        while True:
+            attacks.append(slider_attacks(sq, subset, directions))
+            subset = (subset - mask) & mask
+            if subset == 0:
+                break
+    return masks, offsets, attacks
+
+def pext(value, mask):
+    """Software _pext_u64: the bits of value under mask, packed into the low bits."""
+    result, bit = 0, 0
+    while mask:
+        low = mask & -mask
+        if value & low:
+            result |= 1 << bit
+        bit += 1
+        mask ^= low
+    return result
+
+def compress_attacks(attacks, offsets, directions):
+    """PEXT-layout attacks as 16-bit entries: the attacked squares packed along the square's empty-board rays
+    (at most 14 of them), which _pdep_u64 with those rays expands again."""
+    compressed = []
+    for sq in range(64):
+        rays = slider_attacks(sq, 0, directions)
+        end = offsets[sq + 1] if sq < 63 else len(attacks)
+        compressed.extend(pext(attack, rays) for attack in attacks[offsets[sq]:end])
+    return compressed
+
+def fancy_magic_table(directions, multipliers):
+    """Per-square masks and shifts for classic fancy magics, with their own attack array, since the index
+    ((occupancy & mask) * multiplier) >> shift orders each square's entries differently from PEXT."""
+    masks, shifts, offsets, attacks = [], [], [], []
+    for sq in range(64):
+        mask = slider_mask(sq, directions)
+        shift = 64 - bin(mask).count("1")
+        entries = [0] * (1 << (64 - shift))  # Indices no occupancy maps to are never looked up
+        subset = 0
+        while True:
+            entries[((subset * multipliers[sq]) & MASK64) >> shift] = slider_attacks(sq, subset, directions)
+            subset = (subset - mask) & mask
+            if subset == 0:
+                break
+        masks.append(mask)
+        shifts.append(shift)
+        offsets.append(len(attacks))
+        attacks.extend(entries)
+    return masks, shifts, offsets, attacks
+
+def find_magic(sq, directions, rng):
+    """Random sparse multipliers until one maps every relevant occupancy without a destructive collision."""
+    mask = slider_mask(sq, directions)
+    shift = 64 - bin(mask).count("1")
+    subsets, attacks = [], []
+    subset = 0
+    while True:
+        subsets.append(subset)
+        attacks.append(slider_attacks(sq, subset, directions))
+        subset = (subset - mask) & mask
+        if subset == 0:
+            break
+    while True:
+        multiplier = rng.getrandbits(64) & rng.getrandbits(64) & rng.getrandbits(64)
+        if bin((mask * multiplier) & 0xff00000000000000).count("1") < 6:
+            continue
+        table = {}
+        for subset, attack in zip(subsets, attacks):
+            index = ((subset * multiplier) & MASK64) >> shift
+            if table.setdefault(index, attack) != attack:
+                break
+        else:
+            return multiplier
+
+def find_magics():
+    """Reproduces ROOK_MAGICS and BISHOP_MAGICS below (about a minute), for when the masks or numbering change."""
+    rng = random.Random(1804289383)
+    rook = [find_magic(sq, ROOK_DIRECTIONS, rng) for sq in range(64)]
+    bishop = [find_magic(sq, BISHOP_DIRECTIONS, rng) for sq in range(64)]
+    for name, values in (("ROOK_MAGICS", rook), ("BISHOP_MAGICS", bishop)):
+        print(f"{name} = [")
+        for i in range(0, 64, 4):
+            print("    " + ", ".join(f"0x{v:016x}" for v in values[i:i + 4]) + ",")
+        print("]")
+
+# Found by find_magics(); searching takes too long to do on every build.
+ROOK_MAGICS = [
+    0x26800422c0008110, 0x0040002000100040, 0x4880082000100081, 0x1880068010000800,
+    0x1900100402080100, 0x0200080490010200, 0x03000c4100008a00, 0x22800a4100042a80,
+    0xc814800022400086, 0x4400400020100048, 0xd200808020001000, 0x4412001008402600,
+    0x1001000408001100, 0x0212000802011004, 0x404200014a001488, 0x0040800080004100,
+    0x0000908000400822, 0x00b0004000402008, 0x0000848020001000, 0x0020090021001000,
+    0x1004008008000480, 0x0c01010002080400, 0x0000140028110250, 0x022002000100508c,
+    0x0000401080002080, 0x0140400080201080, 0x0081200100110b40, 0x0080081200402200,
+    0x0000080080800400, 0x1010040080800200, 0x0024020080800100, 0xa280110200208044,
+    0x0000400080800023, 0x8000400080802001, 0x0000402001001900, 0x14d0008111800800,
+    0x0010040080800802, 0x0200020080800400, 0x6101000401010200, 0x0041040442000991,
+    0x000060c00d808002, 0x0450002000414000, 0x0001004020050010, 0x0001100500a10008,
+    0x0088040008008080, 0x0002200410080140, 0x0000010002008080, 0x0004108519520004,
+    0x002e2100c8801100, 0x0082401000200140, 0x0001001420004900, 0x2c00221000390300,
+    0x4981001008000500, 0x0010800400060180, 0x0040014210080400, 0x0000004c10810200,
+    0x0500914024800101, 0x0000402082010012, 0x0002200010084301, 0x8000100100200409,
+    0x0409000208009005, 0x8812000108041002, 0x0040100102482084, 0x0410102411008042,
+]
+BISHOP_MAGICS = [
+    0x8012101202104208, 0x0051901100408024, 0x0004090222082000, 0x1011104a00020005,
+    0x00084840000c0048, 0x20c8900460122a01, 0x0006921010040002, 0x8000403808080400,
+    0x2002104401082210, 0x000020010a060444, 0x0022120802082280, 0x8244490407001000,
+    0x0428184840600000, 0x0800020111082608, 0x1040111088200800, 0x0100010400820808,
+    0x0004102120044100, 0x0402400810094210, 0x80100008008c1010, 0x0008004092024044,
+    0x456e008c020a0028, 0x0804200202012001, 0x00021106880c2210, 0x0445000028880400,
+    0x0218050020204a48, 0x0802901042840800, 0x0120410028080105, 0x0cc0040000410020,
+    0x0000840012802000, 0x00080041820100a0, 0x0012020104012110, 0x200109c821014830,
+    0x0001045000212004, 0x0202080500204141, 0x1080104400080810, 0x8084040400080210,
+    0x0c40010010010041, 0x9210900100028088, 0x1010408080160240, 0x0004012440002401,
+    0x110914200400e071, 0x40020a0505406044, 0x0082082804000804, 0x2318006018000908,
+    0x31006008a0800c00, 0x4001320802000110, 0x1945080800480100, 0x80010c5102020040,
+    0x8000420220202000, 0x0410420084a00401, 0x4050250405540500, 0x1000200020880000,
+    0x0a40801042120000, 0x0040046004210050, 0x1810a00801004024, 0x0004080084008a01,
+    0x010210c610042040, 0x4240028404028200, 0x1102004282882103, 0x100a000204208801,
+    0x002a094021204102, 0x8100401024108420, 0x002018610404114a, 0x0020011000810041,
+]
+
+def line_tables():
+    """between_masks: squares strictly between two aligned squares. line_masks: the full line through both."""
+    between = [[0] * 64 for _ in range(64)]
+    line = [[0] * 64 for _ in range(64)]
+    for sq1 in range(64):
+        for sq2 in range(64):
+            if sq1 == sq2:
+                continue
+            endpoints = (1 << sq1) | (1 << sq2)
+            for directions in (BISHOP_DIRECTIONS, ROOK_DIRECTIONS):
+                if slider_attacks(sq1, 0, directions) & (1 << sq2):
+                    line[sq1][sq2] = (slider_attacks(sq1, 0, directions) & slider_attacks(sq2, 0, directions)) | endpoints
+                    between[sq1][sq2] = slider_attacks(sq1, 1 << sq2, directions) & slider_attacks(sq2, 1 << sq1, directions)
+                    break
+    return between, line
+
+# ------------------------------------------------------------------------------------------------
+# Pawn structure masks
+
+def pawn_masks():
+    files = [0x0101010101010101 << i for i in range(8)]
+    adjacent = [(files[i - 1] if i > 0 else 0) | (files[i + 1] if i < 7 else 0) for i in range(8)]
+    passed = [[0] * 64, [0] * 64]
+    for sq in range(64):
+        file, rank_row = sq % 8, sq // 8
+        span = adjacent[file] | files[file]
+        white_forward = sum(0xff << (r * 8) for r in range(rank_row))          # Rows above, towards rank 8
+        black_forward = sum(0xff << (r * 8) for r in range(rank_row + 1, 8))  # Rows below, towards rank 1
+        passed[WHITE][sq] = span & white_forward
+        passed[BLACK][sq] = span & black_forward
+    return files, adjacent, passed
+
+# ------------------------------------------------------------------------------------------------
+# Output
+
+def hex_list(values, indent="    ", per_line=8, digits=16, suffix="ULL"):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append(indent + ",".join(f"0x{v:0{digits}x}{suffix}" for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+def table_1d(name, values):
+    return f"const U64 {name}[{len(values)}] = {{\n{hex_list(values)}\n}};\n"
+
+def table_2d(name, rows):
+    body = "\n".join("    {\n" + hex_list(row, "    ") + "\n    }," for row in rows)
+    return f"const U64 {name}[{len(rows)}][{len(rows[0])}] = {{\n{body}\n}};\n"
+
+def arena(type_name, name, values, digits, suffix):
+    return f"_Alignas(64) const {type_name} {name}[{len(values)}] = {{\n{hex_list(values, per_line=16, digits=digits, suffix=suffix)}\n}};\n"
+
+def pext_squares(name, masks, directions, offsets):
+    body = "\n".join(f"    {{0x{mask:016x}ULL, 0x{slider_attacks(sq, 0, directions):016x}ULL, {offset}}},"
+                     for sq, (mask, offset) in enumerate(zip(masks, offsets)))
+    return f"const magic {name}[64] = {{\n{body}\n}};\n"
+
+def fancy_magic_squares(name, masks, multipliers, offsets, shifts):
+    body = "\n".join(f"    {{0x{mask:016x}ULL, 0x{multiplier:016x}ULL, {offset}, {shift}}},"
+                     for mask, multiplier, offset, shift in zip(masks, multipliers, offsets, shifts))
+    return f"const fancy_magic {name}[64] = {{\n{body}\n}};\n"
+
+def main():
+    if sys.argv[1:] == ["--find-magics"]:
+        find_magics()
+        return
+    path = sys.argv[1] if len(sys.argv) > 1 else "tables.h"
+
+    piece_keys, side_key, castle_keys, enpassant_keys, material_weights = zobrist_keys()
+    # Each backend gets one arena, bishops first, with per-square offsets into it.
+    bishop_masks, bishop_offsets, bishop_attacks = slider_table(BISHOP_DIRECTIONS)
+    rook_masks, rook_offsets, rook_attacks = slider_table(ROOK_DIRECTIONS)
+    pext_arena = compress_attacks(bishop_attacks, bishop_offsets, BISHOP_DIRECTIONS) + compress_attacks(rook_attacks, rook_offsets, ROOK_DIRECTIONS)
+    rook_offsets = [offset + len(bishop_attacks) for offset in rook_offsets]
+
+    _, bishop_shifts, bishop_magic_offsets, bishop_magic_attacks = fancy_magic_table(BISHOP_DIRECTIONS, BISHOP_MAGICS)
+    _, rook_shifts, rook_magic_offsets, rook_magic_attacks = fancy_magic_table(ROOK_DIRECTIONS, ROOK_MAGICS)
+    magic_arena = bishop_magic_attacks + rook_magic_attacks
+    rook_magic_offsets = [offset + len(bishop_magic_attacks) for offset in rook_magic_offsets]
+    between, line = line_tables()
+    files, adjacent, passed = pawn_masks()
+
+    sections = [
+        "// Generated by generate_tables.py. Do not edit: rerun the script instead.\n",
+        table_2d("zobrist_piece_keys", piece_keys),
+        f"const U64 zobrist_side_key = 0x{side_key:016x}ULL;\n",
+        table_1d("zobrist_castle_keys", castle_keys),
+        table_1d("zobrist_enpassant_keys", enpassant_keys),
+        "// The material key is the sum of these over all pieces, so it depends only on piece counts\n"
+        + table_1d("material_key_weights", material_weights),
+        table_2d("pawn_attacks", [pawn_attacks(WHITE), pawn_attacks(BLACK)]),
+        table_1d("knight_attacks", knight_attacks()),
+        table_1d("king_attacks", king_attacks()),
+        arena("uint16_t", "pext_attack_arena", pext_arena, 4, ""),
+        pext_squares("bishopM", bishop_masks, BISHOP_DIRECTIONS, bishop_offsets),
+        pext_squares("rookM", rook_masks, ROOK_DIRECTIONS, rook_offsets),
+        arena("U64", "magic_attack_arena", magic_arena, 16, "ULL"),
+        fancy_magic_squares("bishop_magics", bishop_masks, BISHOP_MAGICS, bishop_magic_offsets, bishop_shifts),
+        fancy_magic_squares("rook_magics", rook_masks, ROOK_MAGICS, rook_magic_offsets, rook_shifts),
+        table_2d("between_masks", between),
+        table_2d("line_masks", line),
+        table_1d("file_masks", files),
+        table_1d("adjacent_files_masks", adjacent),
+        table_2d("passed_pawn_masks", passed),
+    ]
+
+    with open(path, "w") as out:
+        out.write("\n".join(sections))
+
+if __name__ == "__main__":
+    main()